@@ -0,0 +1,225 @@
+// Incremental, resumable conversion with per-shard output caching.
+//
+// Every input shard is converted into segments of about kSegmentSize events, each its own file in the cache
+// directory <output>.cache/:
+//     shard_<i>.key            identity of the input the cached segments were converted from
+//     shard_<i>.<first>.root   output of the shard's events [first, first + segment length)
+// A segment file only appears, by rename, once it is complete, so a job killed mid-shard resumes at the first
+// missing segment. The key holds the converter and geometry versions, the shard's position in the input (its
+// TrackID offset and length) and its size, modification time and MD5 checksum. Size and modification time detect an
+// unchanged shard without reading it; when either changed, the checksum decides whether the cache is still valid.
+// The segments are then fast-merged into the output, which is skipped when nothing changed since the last merge.
+
+#ifndef ZDC_CONVERSION_CACHE_H
+#define ZDC_CONVERSION_CACHE_H
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TError.h"
+#include "TMD5.h"
+#include "TSystem.h"
+#include "ZDCConversionEngine.h"
+#include "ZDCGeometry.h"
+
+namespace ZDC {
+
+// Default number of events per cached segment, the granularity at which an interrupted conversion resumes
+const Long64_t kSegmentSize = 100000;
+
+// Field name -> value, stored one "name value" pair per line
+typedef std::map<std::string, std::string> CacheKey;
+
+inline std::string CacheDir(const std::string &outName) {
+    return outName + ".cache";
+}
+
+inline CacheKey ReadCacheKey(const std::string &path) {
+    CacheKey key;
+    std::ifstream in(path);
+    std::string name, value;
+    while (in >> name && std::getline(in >> std::ws, value)) {
+        key[name] = value;
+    }
+    return key;
+}
+
+// Writes the key next to its final name and renames it into place, so a key file is never partially written
+inline void WriteCacheKey(const std::string &path, const CacheKey &key) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp);
+        for (const auto &field : key) {
+            out << field.first << " " << field.second << "\n";
+        }
+    }
+    gSystem->Rename(tmp.c_str(), path.c_str());
+}
+
+inline std::string FileChecksum(const std::string &path) {
+    std::unique_ptr<TMD5> md5(TMD5::FileChecksum(path.c_str()));
+    return md5 ? md5->AsString() : "";
+}
+
+// Key of shard i, without its checksum, which is only computed when needed
+inline CacheKey ShardCacheKey(const ShardList &shards, size_t i, const std::string &converter, Long64_t segmentSize) {
+    CacheKey key;
+    FileStat_t stat;
+    gSystem->GetPathInfo(shards.files[i].c_str(), stat);
+    key["converter"] = converter;
+    key["geometry"] = Form("%d", kGeometryVersion);
+    key["file"] = shards.files[i];
+    key["offset"] = Form("%lld", shards.offsets[i]);
+    key["entries"] = Form("%lld", shards.entries[i]);
+    key["segment"] = Form("%lld", segmentSize);
+    key["size"] = Form("%lld", stat.fSize);
+    key["mtime"] = Form("%ld", stat.fMtime);
+    return key;
+}
+
+// Whether the cached segments of a shard were converted from the same input by the same converter.
+// Fills in the checksum of key whenever it had to be computed.
+inline bool MatchCacheKey(const CacheKey &cached, CacheKey &key) {
+    for (const auto &field : key) {
+        if (field.first == "size" || field.first == "mtime" || field.first == "md5") continue;
+        auto it = cached.find(field.first);
+        if (it == cached.end() || it->second != field.second) return false;
+    }
+    // A key missing any of these (hand edited, older format) only matches through its checksum
+    auto cachedMD5 = cached.find("md5"), cachedSize = cached.find("size"), cachedMtime = cached.find("mtime");
+    if (cachedMD5 == cached.end()) return false;
+    if (cachedSize != cached.end() && cachedSize->second == key["size"] && cachedMtime != cached.end() &&
+        cachedMtime->second == key["mtime"]) {
+        key["md5"] = cachedMD5->second;
+        return true;
+    }
+    key["md5"] = FileChecksum(key["file"]);
+    return key["md5"] == cachedMD5->second;
+}
+
+// Size and modification time of the merged output, so that a manifest only matches the file it was written for
+inline void AddOutputStat(CacheKey &manifest, const std::string &outName) {
+    FileStat_t stat;
+    bool exists = gSystem->GetPathInfo(outName.c_str(), stat) == 0;
+    manifest["output_size"] = exists ? Form("%lld", stat.fSize) : "none";
+    manifest["output_mtime"] = exists ? Form("%ld", stat.fMtime) : "none";
+}
+
+// Removes every cached file of shard i
+inline void ClearShardCache(const std::string &cacheDir, size_t i) {
+    std::string prefix = Form("shard_%zu.", i);
+    void *dir = gSystem->OpenDirectory(cacheDir.c_str());
+    if (!dir) return;
+    std::vector<std::string> stale;
+    while (const char *entry = gSystem->GetDirEntry(dir)) {
+        if (std::string(entry).compare(0, prefix.size(), prefix) == 0) stale.push_back(cacheDir + "/" + entry);
+    }
+    gSystem->FreeDirectory(dir);
+    for (const auto &file : stale) {
+        gSystem->Unlink(file.c_str());
+    }
+}
+
+// Converts the shards into outName through the cache, converting only the segments that are missing or stale.
+// converter identifies the converter, its version and any option changing its output.
+inline bool ConvertIncremental(const ShardList &shards, const std::string &outName, int nThreads,
+                               const ChunkConverter &convert, const std::string &converter,
+                               Long64_t segmentSize = kSegmentSize) {
+    if (!shards.valid) {
+        Error("ZDC::ConvertIncremental", "Not converting into %s, the input shards are incomplete", outName.c_str());
+        return false;
+    }
+    std::string cacheDir = CacheDir(outName);
+    gSystem->mkdir(cacheDir.c_str(), kTRUE);
+
+    std::vector<Chunk> segments, missing;
+    std::vector<std::string> segmentFiles;
+    int nStaleShards = 0;
+    for (size_t i = 0; i < shards.files.size(); i++) {
+        std::string keyFile = Form("%s/shard_%zu.key", cacheDir.c_str(), i);
+        CacheKey cached = ReadCacheKey(keyFile);
+        CacheKey key = ShardCacheKey(shards, i, converter, segmentSize);
+        if (!MatchCacheKey(cached, key)) {
+            nStaleShards++;
+            ClearShardCache(cacheDir, i);
+            if (key["md5"].empty()) key["md5"] = FileChecksum(shards.files[i]);
+            WriteCacheKey(keyFile, key);
+        } else if (cached != key) {
+            // Touched but unchanged: remember the new modification time so the checksum is not computed again
+            WriteCacheKey(keyFile, key);
+        }
+
+        size_t first = segments.size();
+        SplitShard(shards, i, segmentSize, segments);
+        for (size_t s = first; s < segments.size(); s++) {
+            segments[s].index = s;
+            segmentFiles.push_back(Form("%s/shard_%zu.%lld.root", cacheDir.c_str(), i,
+                                        segments[s].firstEntry - shards.offsets[i]));
+            // AccessPathName is true when the file does not exist
+            if (gSystem->AccessPathName(segmentFiles[s].c_str())) missing.push_back(segments[s]);
+        }
+    }
+    Info("ZDC::ConvertIncremental", "%d of %zu shards changed, converting %zu of %zu segments", nStaleShards,
+         shards.files.size(), missing.size(), segments.size());
+
+    Long64_t missingEvents = 0;
+    for (const auto &segment : missing) {
+        missingEvents += segment.lastEntry - segment.firstEntry;
+    }
+    Monitor().Begin(outName, missingEvents);
+    std::atomic<int> nFailed{0};
+    if (!missing.empty()) {
+        RunChunks(missing, nThreads, [&](const Chunk &segment) {
+            // A failed segment stays missing, so the next run converts it again
+            std::string tmp = segmentFiles[segment.index] + ".tmp";
+            if (convert(shards, segment, tmp)) {
+                gSystem->Rename(tmp.c_str(), segmentFiles[segment.index].c_str());
+            } else {
+                gSystem->Unlink(tmp.c_str());
+                nFailed++;
+            }
+        });
+    }
+    if (nFailed > 0) {
+        Monitor().End(SummaryName(outName));
+        Error("ZDC::ConvertIncremental", "%d of %zu segments failed, %s was not updated", nFailed.load(),
+              missing.size(), outName.c_str());
+        return false;
+    }
+
+    // The list of merged segments and the output they were merged into. If it is unchanged, no segment was converted
+    // and the output is still the file written by the last merge (not, say, a later non-incremental conversion into
+    // the same name), the output is up to date.
+    std::string manifestFile = cacheDir + "/merged.key";
+    CacheKey manifest;
+    manifest["output"] = outName;
+    for (size_t s = 0; s < segmentFiles.size(); s++) {
+        manifest[Form("segment%06zu", s)] = segmentFiles[s];
+    }
+    CacheKey current = manifest;
+    AddOutputStat(current, outName);
+    if (missing.empty() && ReadCacheKey(manifestFile) == current) {
+        Monitor().End(SummaryName(outName));
+        Info("ZDC::ConvertIncremental", "%s is up to date", outName.c_str());
+        return true;
+    }
+
+    gSystem->Unlink(manifestFile.c_str());
+    bool merged;
+    {
+        ScopedStage merge(Monitor().NewCounters(), kStageMerge);
+        merged = MergeFiles(outName, segmentFiles);
+    }
+    Monitor().End(SummaryName(outName));
+    if (!merged) return false;
+    AddOutputStat(manifest, outName);
+    WriteCacheKey(manifestFile, manifest);
+    return true;
+}
+
+} // namespace ZDC
+
+#endif
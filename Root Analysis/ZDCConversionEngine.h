@@ -0,0 +1,290 @@
+// Multi-threaded conversion engine shared by the tree converters.
+//
+// The input shards (<name>_0.root ... <name>_{N-1}.root) are split into chunks of consecutive events.
+// Chunks never cross a shard boundary and are aligned to the ZDC1tree clusters where possible.
+// Every chunk is converted into its own part file by a worker thread, and the part files are
+// fast-merged in chunk order, so the merged tree is identical to the one the serial path writes
+// (TrackID is always the global event index).
+// Every conversion reports its progress and leaves a stage timing summary next to the output, see ZDCInstrumentation.h.
+
+#ifndef ZDC_CONVERSION_ENGINE_H
+#define ZDC_CONVERSION_ENGINE_H
+
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <glob.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TChain.h"
+#include "TError.h"
+#include "TFile.h"
+#include "TFileMerger.h"
+#include "TROOT.h"
+#include "TSystem.h"
+#include "TTree.h"
+#include "ROOT/TThreadExecutor.hxx"
+#include "ZDCInstrumentation.h"
+
+namespace ZDC {
+
+// Trees every input shard holds, all with one entry per event
+inline const char *const kInputTrees[6] = {"EventData", "RPD1tree", "ZDC1tree", "ZDC2tree", "ZDC3tree", "ZDC4tree"};
+
+// Input shards together with the number of events in each of them
+struct ShardList {
+    std::vector<std::string> files;
+    std::vector<Long64_t> entries;                // Events in each shard
+    std::vector<Long64_t> offsets;                // Global index of the first event of each shard
+    std::vector<std::vector<Long64_t>> clusters;  // Cluster start entries of ZDC1tree within each shard
+    Long64_t total = 0;
+    bool valid = true;                            // False if a shard is missing or its trees disagree in length
+};
+
+// Consecutive global events [firstEntry, lastEntry) converted as one unit of work
+struct Chunk {
+    int index;
+    Long64_t firstEntry;
+    Long64_t lastEntry;
+};
+
+// Converts a single chunk into the given output file, false if it could not be read or written completely
+typedef std::function<bool(const ShardList &, const Chunk &, const std::string &)> ChunkConverter;
+
+// Filenames of num_files consecutive shards, <base>_0.root ... <base>_{num_files-1}.root
+inline std::vector<std::string> ShardFiles(const std::string &base, int num_files) {
+    std::vector<std::string> files;
+    for (int i = 0; i < num_files; i++) {
+        files.push_back(Form("%s_%d.root", base.c_str(), i));
+    }
+    return files;
+}
+
+// Orders shard names by their numeric parts, so <base>_2.root comes before <base>_10.root
+inline bool ShardNameLess(const std::string &a, const std::string &b) {
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        if (isdigit(a[i]) && isdigit(b[j])) {
+            size_t iEnd = a.find_first_not_of("0123456789", i), jEnd = b.find_first_not_of("0123456789", j);
+            std::string x = a.substr(i, iEnd - i), y = b.substr(j, jEnd - j);
+            x.erase(0, std::min(x.find_first_not_of('0'), x.size() - 1));
+            y.erase(0, std::min(y.find_first_not_of('0'), y.size() - 1));
+            if (x.size() != y.size()) return x.size() < y.size();
+            if (x != y) return x < y;
+            i = iEnd == std::string::npos ? a.size() : iEnd;
+            j = jEnd == std::string::npos ? b.size() : jEnd;
+        } else {
+            if (a[i] != b[j]) return a[i] < b[j];
+            i++;
+            j++;
+        }
+    }
+    return a.size() - i < b.size() - j;
+}
+
+// Filenames matching a shell pattern such as "data/run4_1p_380G_*.root", in shard order
+inline std::vector<std::string> MatchShards(const std::string &pattern) {
+    std::vector<std::string> files;
+    glob_t matches;
+    if (glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+        files.assign(matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+    }
+    globfree(&matches);
+    std::sort(files.begin(), files.end(), ShardNameLess);
+    return files;
+}
+
+// Opens every shard once to record its number of events and its cluster boundaries.
+// All six input trees of a shard must have the same number of entries, otherwise the list is marked invalid.
+inline ShardList ScanShards(const std::vector<std::string> &files) {
+    ShardList shards;
+    for (const auto &file : files) {
+        Long64_t nEntries = 0;
+        std::vector<Long64_t> clusters;
+
+        TFile *f = TFile::Open(file.c_str(), "READ");
+        if (!f || f->IsZombie()) {
+            Error("ZDC::ScanShards", "Cannot open %s", file.c_str());
+            delete f;
+            shards.valid = false;
+            break;
+        }
+
+        TTree *trees[6] = {nullptr};
+        for (int t = 0; t < 6; t++) {
+            f->GetObject(kInputTrees[t], trees[t]);
+            if (!trees[t]) {
+                Error("ZDC::ScanShards", "%s has no %s, it is not an input shard", file.c_str(), kInputTrees[t]);
+                shards.valid = false;
+            }
+        }
+        if (shards.valid) {
+            TTree *tree = trees[2]; // ZDC1tree
+            nEntries = tree->GetEntries();
+            auto it = tree->GetClusterIterator(0);
+            for (Long64_t start = it(); start < nEntries; start = it()) {
+                clusters.push_back(start);
+            }
+            for (int t = 0; t < 6; t++) {
+                if (trees[t]->GetEntries() != nEntries) {
+                    Error("ZDC::ScanShards", "%s: %s has %lld entries but ZDC1tree has %lld", file.c_str(),
+                          kInputTrees[t], trees[t]->GetEntries(), nEntries);
+                    shards.valid = false;
+                }
+            }
+        }
+        delete f;
+        if (!shards.valid) break;
+
+        shards.files.push_back(file);
+        shards.entries.push_back(nEntries);
+        shards.offsets.push_back(shards.total);
+        shards.clusters.push_back(clusters);
+        shards.total += nEntries;
+    }
+    return shards;
+}
+
+// Number of worker threads to use, 0 (or less) meaning one per core
+inline int ThreadCount(int nThreads) {
+    if (nThreads > 0) return nThreads;
+    int nCores = std::thread::hardware_concurrency();
+    return nCores > 0 ? nCores : 1;
+}
+
+// Appends shard i to chunks, cut into pieces of about target events at cluster boundaries
+inline void SplitShard(const ShardList &shards, size_t i, Long64_t target, std::vector<Chunk> &chunks) {
+    if (target < 1) target = 1;
+    Long64_t start = 0;
+    while (start < shards.entries[i]) {
+        Long64_t stop = start + target;
+        if (stop >= shards.entries[i]) {
+            stop = shards.entries[i];
+        } else {
+            // Move the cut forward to the next cluster boundary so no cluster is read by two chunks
+            Long64_t boundary = shards.entries[i];
+            for (Long64_t cluster : shards.clusters[i]) {
+                if (cluster >= stop) {
+                    boundary = cluster;
+                    break;
+                }
+            }
+            stop = boundary;
+        }
+        chunks.push_back({(int) chunks.size(), shards.offsets[i] + start, shards.offsets[i] + stop});
+        start = stop;
+    }
+}
+
+// Splits the shards into roughly nChunks chunks of equal size, cutting shards at cluster boundaries
+inline std::vector<Chunk> PlanChunks(const ShardList &shards, int nChunks) {
+    std::vector<Chunk> chunks;
+    Long64_t target = (shards.total + nChunks - 1) / (nChunks > 0 ? nChunks : 1);
+    for (size_t i = 0; i < shards.files.size(); i++) {
+        SplitShard(shards, i, target, chunks);
+    }
+    return chunks;
+}
+
+// The whole input as a single chunk, used by the serial path
+inline Chunk WholeInput(const ShardList &shards) {
+    return {0, 0, shards.total};
+}
+
+// Adds the shards overlapping the chunk to the chain without opening them.
+// Returns the global index of the chain's first entry, so that entry = q - base for global event q.
+inline Long64_t AddShards(TChain &chain, const ShardList &shards, const Chunk &chunk) {
+    Long64_t base = -1;
+    for (size_t i = 0; i < shards.files.size(); i++) {
+        Long64_t first = shards.offsets[i], last = shards.offsets[i] + shards.entries[i];
+        if (shards.entries[i] == 0 || last <= chunk.firstEntry || first >= chunk.lastEntry) continue;
+        if (base < 0) base = first;
+        chain.Add(shards.files[i].c_str(), shards.entries[i]);
+    }
+    return base < 0 ? chunk.firstEntry : base;
+}
+
+// Temporary output file of a single chunk
+inline std::string PartName(const std::string &outName, int index) {
+    return Form("%s.part%d.root", outName.c_str(), index);
+}
+
+// Runs func on every chunk using nThreads worker threads
+inline void RunChunks(std::vector<Chunk> &chunks, int nThreads, const std::function<void(const Chunk &)> &func) {
+    ROOT::EnableThreadSafety();
+    ROOT::TThreadExecutor pool(ThreadCount(nThreads));
+    pool.Foreach([&](Chunk &chunk) { func(chunk); }, chunks);
+}
+
+// Fast-merges files into outName in the given order. Trees are concatenated by copying their compressed baskets,
+// histograms are added up.
+inline bool MergeFiles(const std::string &outName, const std::vector<std::string> &files) {
+    TFileMerger merger(kFALSE);
+    merger.SetPrintLevel(0);
+    merger.SetFastMethod(kTRUE);
+    merger.OutputFile(outName.c_str(), "RECREATE");
+    for (const auto &file : files) {
+        merger.AddFile(file.c_str(), kFALSE);
+    }
+    bool merged = merger.Merge();
+    if (!merged) Error("ZDC::MergeFiles", "Failed to merge the chunk outputs into %s", outName.c_str());
+    return merged;
+}
+
+// Fast-merges the part files of all chunks into outName, in chunk order, and removes them
+inline bool MergeParts(const std::string &outName, const std::vector<Chunk> &chunks) {
+    std::vector<std::string> parts;
+    for (const auto &chunk : chunks) {
+        parts.push_back(PartName(outName, chunk.index));
+    }
+    bool merged = MergeFiles(outName, parts);
+
+    for (const auto &part : parts) {
+        gSystem->Unlink(part.c_str());
+    }
+    return merged;
+}
+
+// Converts all shards into outName.
+// nThreads = 1 runs the converter once over the whole input, anything else splits it over worker threads.
+inline bool Convert(const ShardList &shards, const std::string &outName, int nThreads, const ChunkConverter &convert) {
+    if (!shards.valid) {
+        Error("ZDC::Convert", "Not converting into %s, the input shards are incomplete", outName.c_str());
+        return false;
+    }
+    Monitor().Begin(outName, shards.total);
+    if (nThreads == 1 || shards.total == 0) {
+        bool converted = convert(shards, WholeInput(shards), outName);
+        Monitor().End(SummaryName(outName));
+        if (!converted) Error("ZDC::Convert", "Failed to convert into %s", outName.c_str());
+        return converted;
+    }
+
+    // A few chunks per thread keep the workers busy when shards differ in size
+    std::vector<Chunk> chunks = PlanChunks(shards, 4 * ThreadCount(nThreads));
+    std::vector<char> converted(chunks.size(), 0);    // Not vector<bool>, every chunk writes its own element
+    RunChunks(chunks, nThreads, [&](const Chunk &chunk) {
+        converted[chunk.index] = convert(shards, chunk, PartName(outName, chunk.index));
+    });
+    int nFailed = std::count(converted.begin(), converted.end(), 0);
+    if (nFailed > 0) {
+        for (const auto &chunk : chunks) {
+            gSystem->Unlink(PartName(outName, chunk.index).c_str());
+        }
+        Monitor().End(SummaryName(outName));
+        Error("ZDC::Convert", "%d of %zu chunks failed, %s was not written", nFailed, chunks.size(), outName.c_str());
+        return false;
+    }
+    bool merged;
+    {
+        ScopedStage merge(Monitor().NewCounters(), kStageMerge);
+        merged = MergeParts(outName, chunks);
+    }
+    Monitor().End(SummaryName(outName));
+    return merged;
+}
+
+} // namespace ZDC
+
+#endif
@@ -0,0 +1,62 @@
+// Chunk converters of the tree converter macros and the batch interface of the compiled libZDCConversion.
+//
+// Each converter turns the events of a chunk into its output tree:
+//     run4    Run4TreeConverter.C       Run4Tree with hit rows/columns per module (or compact hit maps)
+//     tb21    TestBeamTreeConverter.C   TestBeamTree with the 2021 test beam segmentation and run histograms
+//     zseg    ZConverter.C              Run4Tree with the EM rows hit in each event
+//     legacy  TreeConverter.C           TestBeam_Tree with the longitudinal segments of the 28 rods/row geometry
+// The macros still run in a root session; RunConversion is what zdc-convert calls.
+
+#ifndef ZDC_CONVERTERS_H
+#define ZDC_CONVERTERS_H
+
+#include <string>
+#include <vector>
+#include "ZDCConversionEngine.h"
+
+// Layout of the hit maps in the Run4Tree
+enum Run4OutputMode {
+    kRun4HitVectors = 0,    // EM_Row, EM_Column, HAD_Row, HAD_Column, Total_Row, Total_Column, one element per hit
+    kRun4CompactHits = 1    // Sorted, delta-encoded rods of each module with their hit counts, see ZDCHitMap.h
+};
+
+// Versions of the output layouts, part of the incremental conversion cache key. Bump one whenever its output changes.
+const int kRun4ConverterVersion = 1;
+const int kTB21ConverterVersion = 1;
+const int kZSegConverterVersion = 2;
+const int kLegacyConverterVersion = 1;
+
+bool Run4ConvertChunk(const ZDC::ShardList &shards, const ZDC::Chunk &chunk, const std::string &outName,
+                      int outputMode);
+bool TestBeamConvertChunk(const ZDC::ShardList &shards, const ZDC::Chunk &chunk, const std::string &outName);
+bool ZSegConvertChunk(const ZDC::ShardList &shards, const ZDC::Chunk &chunk, const std::string &outName);
+bool LegacyConvertChunk(const ZDC::ShardList &shards, const ZDC::Chunk &chunk, const std::string &outName);
+
+namespace ZDC {
+
+struct ConvertOptions {
+    std::string mode;           // run4, tb21, zseg or legacy
+    std::string input;          // Shell pattern of the input shards, e.g. "data/run4_1p_380G_*.root"
+    std::string output;
+    int nThreads = 1;           // 0 = one per core
+    bool compact = false;       // run4 only, compact hit-map layout
+    bool incremental = false;   // Reuse the cached output of unchanged shards, see ZDCConversionCache.h
+};
+
+struct ConvertReport {
+    bool ok = false;
+    size_t nShards = 0;
+    Long64_t events = 0;        // Events converted in this run, only those of changed shards when incremental
+    double seconds = 0;         // Wall time of the conversion, from scanning the shards to the merged output
+};
+
+// Converter of a mode and the identifier of its output layout, an empty function for an unknown mode
+ChunkConverter FindConverter(const ConvertOptions &options, std::string &version);
+
+// Converts the shards matching options.input into options.output.
+// Matches that are options.output itself, its part files or its cache are not used as input.
+ConvertReport RunConversion(const ConvertOptions &options);
+
+} // namespace ZDC
+
+#endif
@@ -0,0 +1,162 @@
+// Aligned reader of the six input trees (EventData, RPD1tree, ZDC1tree ... ZDC4tree) of a chunk.
+//
+// ZDC1tree is the main chain and the other trees the converter reads from are its friends, so one GetEntry reads
+// the same event from all of them. Only the branches registered with SetBranchAddress are read (and decompressed);
+// every chain has its own TTreeCache holding exactly those branches, and trees nothing is read from are never
+// opened. Shards whose trees disagree in length are rejected by ZDC::ScanShards before any of this happens.
+// ConvertChunkEvents wraps the source in the open/read/write skeleton every chunk converter shares.
+
+#ifndef ZDC_EVENT_SOURCE_H
+#define ZDC_EVENT_SOURCE_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "TChain.h"
+#include "TEnv.h"
+#include "TFile.h"
+#include "ZDCConversionEngine.h"
+#include "ZDCInstrumentation.h"
+
+namespace ZDC {
+
+// Index of each tree in kInputTrees
+enum InputTree { kEventData = 0, kRPD1tree, kZDC1tree, kZDC2tree, kZDC3tree, kZDC4tree };
+
+class EventSource {
+public:
+    // Default TTreeCache size of each chain
+    static const Long64_t kCacheSize = 16 * 1024 * 1024;
+
+    // Lets the TTreeCaches prefetch the next cluster in a background thread while the current one is processed.
+    // Call before any input file is opened.
+    static void EnableAsyncPrefetching() {
+        gEnv->SetValue("TFile.AsyncPrefetching", 1);
+    }
+
+    EventSource(const ShardList &shards, const Chunk &chunk, Long64_t cacheSize = kCacheSize)
+            : fCacheSize(cacheSize), fActive(6) {
+        for (int t = 0; t < 6; t++) {
+            fChains.push_back(new TChain(kInputTrees[t]));
+            fBase = AddShards(*fChains[t], shards, chunk);
+        }
+    }
+
+    ~EventSource() {
+        // The main chain first, it holds the friend elements of the others
+        delete fChains[kZDC1tree];
+        for (int t = 0; t < 6; t++) {
+            if (t != kZDC1tree) delete fChains[t];
+        }
+    }
+
+    // Reads branch of the given tree into address, the way TTree::SetBranchAddress does
+    template <class T>
+    void SetBranchAddress(int tree, const char *branch, T *address) {
+        fChains[tree]->SetBranchAddress(branch, address);
+        fActive[tree].push_back(branch);
+    }
+
+    // Reads global event q of all trees, returns the number of bytes read, or -1 if a tree could not be loaded
+    Int_t GetEntry(Long64_t q) {
+        if (!fReady) Setup();
+        if (fFailed) return -1;
+        return fChains[kZDC1tree]->GetEntry(q - fBase);
+    }
+
+    // Chain of one of the input trees
+    TChain *GetChain(int tree) const { return fChains[tree]; }
+
+private:
+    // Restricts every chain to its registered branches, sets up the caches and attaches the friends.
+    // A chain that cannot be loaded fails the source, its branches would otherwise never be filled.
+    void Setup() {
+        fReady = true;
+        TChain *main = fChains[kZDC1tree];
+        // The main chain goes first: branch statuses set on it would otherwise spread to the friends
+        const int order[6] = {kZDC1tree, kEventData, kRPD1tree, kZDC2tree, kZDC3tree, kZDC4tree};
+        for (int t : order) {
+            TChain *chain = fChains[t];
+            if (t != kZDC1tree && fActive[t].empty()) continue;
+
+            chain->SetBranchStatus("*", 0);
+            for (const auto &branch : fActive[t]) {
+                chain->SetBranchStatus(branch.c_str(), 1);
+            }
+            if (chain->LoadTree(0) < 0) {
+                Error("ZDC::EventSource", "Cannot load %s from the %d files of this chunk", kInputTrees[t],
+                      chain->GetNtrees());
+                fFailed = true;
+                return;
+            }
+
+            chain->SetCacheSize(fCacheSize);
+            for (const auto &branch : fActive[t]) {
+                chain->AddBranchToCache(branch.c_str(), kTRUE);
+            }
+            chain->StopCacheLearningPhase();
+
+            if (t != kZDC1tree) main->AddFriend(chain);
+        }
+    }
+
+    Long64_t fCacheSize;
+    Long64_t fBase = 0;
+    bool fReady = false;
+    bool fFailed = false;
+    std::vector<TChain *> fChains;
+    std::vector<std::vector<std::string>> fActive;
+};
+
+// Segments global event q, just read by the source, and fills the output; times its own segment and fill stages
+typedef std::function<void(Long64_t q, StageCounters &stats)> EventConverter;
+
+// Event loop shared by the chunk converters. Creates outName, calls book to create the output tree in it and give the
+// source the addresses of the input branches, passes every global event of [chunk.firstEntry, chunk.lastEntry) to
+// convert, then writes the output and calls finish (if given) to write anything else into it.
+// Returns false if the output could not be created or written, or an event could not be read.
+inline bool ConvertChunkEvents(const char *converter, const ShardList &shards, const Chunk &chunk,
+                               const std::string &outName, const std::function<void(EventSource &)> &book,
+                               const EventConverter &convert,
+                               const std::function<bool(TFile *)> &finish = std::function<bool(TFile *)>()) {
+    TFile *fOut = new TFile(outName.c_str(), "RECREATE");
+    if (fOut->IsZombie()) {
+        Error(converter, "Cannot create %s", outName.c_str());
+        delete fOut;
+        return false;
+    }
+    // The source reads all six trees of this chunk in lockstep, and only the branches book gives addresses to
+    EventSource source(shards, chunk);
+    book(source);
+
+    // Stage timers and event count of this chunk, reported by Monitor()
+    StageCounters &stats = Monitor().NewCounters();
+    bool ok = true;
+    for (Long64_t q = chunk.firstEntry; q < chunk.lastEntry; q++) {
+        // 0 or less is a missing entry, a read error or a tree that could not be loaded
+        {
+            ScopedStage read(stats, kStageRead);
+            ok = source.GetEntry(q) > 0;
+        }
+        if (!ok) {
+            Error(converter, "Failed to read event %lld into %s", q, outName.c_str());
+            break;
+        }
+        convert(q, stats);
+        Monitor().EventDone(stats);
+    }
+    {
+        ScopedStage write(stats, kStageWrite);
+        if (fOut->Write() <= 0 || (finish && !finish(fOut))) {
+            Error(converter, "Failed to write %s", outName.c_str());
+            ok = false;
+        }
+        fOut->Close();
+        delete fOut;
+    }
+    return ok;
+}
+
+} // namespace ZDC
+
+#endif
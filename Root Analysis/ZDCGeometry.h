@@ -0,0 +1,127 @@
+// Detector geometry shared by the tree converters.
+//
+// Each configuration is described by a GeometryDescriptor. From it, lookup tables are built at compile time that map
+// every rod ID of a module to a packed RodCell, so the hit loop does a single table lookup per hit instead of
+// repeated divisions and modulos. Rod IDs outside the tables fall back to the same arithmetic the tables are built
+// with, so the result never depends on which path was taken.
+
+#ifndef ZDC_GEOMETRY_H
+#define ZDC_GEOMETRY_H
+
+#include <array>
+#include <cstdint>
+
+namespace ZDC {
+
+// Bumped whenever a descriptor or the segmentation changes, so previously converted output is not reused
+inline constexpr int kGeometryVersion = 1;
+
+// Rod layout of one detector configuration
+struct GeometryDescriptor {
+    int emRodsPerRow;           // Rods in a single row (radiator gap) of the EM module
+    int emRows;                 // Rows in the EM module
+    int hadRodsPerRow;          // Rods in a single row of each HAD module
+    int hadRowsPerModule;       // Rows in each HAD module
+    int emSegStartRow[2];       // First row of the EM2 and EM3 longitudinal segments
+    int hadRowsPerSeg;          // Rows in each HAD longitudinal segment
+    int hadTotalRowOffset;      // Total_Row index of the first HAD1 row
+    int emTotalColumnOffset;    // Shift of EM columns in Total_Column, centering the narrower EM module
+    int rpdRods;                // Rods (fibers) in the RPD
+    int rpdRows;                // Rows of RPD tiles
+    int rpdTilesPerRow;         // Tiles in each RPD row
+};
+
+// Run 4 configuration: 26 EM and 3 x 12 HAD rows of 29 rods
+inline constexpr GeometryDescriptor kRun4 = {29, 26, 29, 12, {8, 17}, 6, 26, 0, 256, 4, 4};
+
+// Test Beam 2021 configuration: 11 EM rows of 29 rods and 3 x 12 HAD rows of 59 rods
+inline constexpr GeometryDescriptor kTestBeam2021 = {29, 11, 59, 12, {8, 17}, 6, 11, 15, 256, 4, 4};
+
+// Layout used by the original TreeConverter: 25 EM and 3 x 12 HAD radiator gaps of 28 rods
+inline constexpr GeometryDescriptor kLegacy = {28, 25, 28, 12, {8, 17}, 6, 25, 0, 256, 4, 4};
+
+// Position of a single rod
+struct RodCell {
+    int16_t row;            // Row within EM_Row / HAD_Row (HAD modules stacked, HAD1 = 0-11, HAD2 = 12-23, ...)
+    int16_t column;         // Column within the module
+    int16_t longSeg;        // Longitudinal segment, index into EM_Seg / HAD_Seg
+    int16_t totalRow;       // Row within the combined EM + HAD stack
+    int16_t totalColumn;    // Column within the combined EM + HAD stack
+};
+
+// Position of rod in module mod (0 = EM, 1-3 = HAD1-3)
+constexpr RodCell ComputeCell(const GeometryDescriptor &g, int mod, int rod) {
+    RodCell cell = {0, 0, 0, 0, 0};
+    if (mod == 0) {
+        int row = rod / g.emRodsPerRow;
+        cell.row = row;
+        cell.column = rod % g.emRodsPerRow;
+        cell.longSeg = row < g.emSegStartRow[0] ? 0 : (row < g.emSegStartRow[1] ? 1 : 2);
+        cell.totalRow = row;
+        cell.totalColumn = cell.column + g.emTotalColumnOffset;
+    } else {
+        int row = rod / g.hadRodsPerRow;
+        int segsPerModule = g.hadRowsPerModule / g.hadRowsPerSeg;
+        cell.row = row + (mod - 1) * g.hadRowsPerModule;
+        cell.column = rod % g.hadRodsPerRow;
+        cell.longSeg = row / g.hadRowsPerSeg + (mod - 1) * segsPerModule;
+        cell.totalRow = cell.row + g.hadTotalRowOffset;
+        cell.totalColumn = cell.column;
+    }
+    return cell;
+}
+
+// Tile of an RPD rod, only row and column are used
+constexpr RodCell ComputeRpdCell(const GeometryDescriptor &g, int rod) {
+    int rodsPerRow = g.rpdRods / g.rpdRows;
+    int rodsPerTile = rodsPerRow / g.rpdTilesPerRow;
+    RodCell cell = {0, 0, 0, 0, 0};
+    cell.row = rod / rodsPerRow;
+    cell.column = (rod % rodsPerRow) / rodsPerTile;
+    cell.totalRow = cell.row;
+    cell.totalColumn = cell.column;
+    return cell;
+}
+
+template <int N>
+constexpr std::array<RodCell, N> BuildTable(const GeometryDescriptor &g, int mod) {
+    std::array<RodCell, N> table = {};
+    for (int rod = 0; rod < N; rod++) {
+        table[rod] = mod < 4 ? ComputeCell(g, mod, rod) : ComputeRpdCell(g, rod);
+    }
+    return table;
+}
+
+// Compile-time lookup tables of one configuration
+template <const GeometryDescriptor &G>
+struct Geometry {
+    static constexpr int kEMRods = G.emRows * G.emRodsPerRow;
+    static constexpr int kHADRods = G.hadRowsPerModule * G.hadRodsPerRow;
+    static constexpr int kRPDRods = G.rpdRods;
+
+    static constexpr std::array<RodCell, kEMRods> em = BuildTable<kEMRods>(G, 0);
+    static constexpr std::array<std::array<RodCell, kHADRods>, 3> had = {
+            BuildTable<kHADRods>(G, 1), BuildTable<kHADRods>(G, 2), BuildTable<kHADRods>(G, 3)};
+    static constexpr std::array<RodCell, kRPDRods> rpd = BuildTable<kRPDRods>(G, 4);
+
+    // Position of rod in module mod (0 = EM, 1-3 = HAD1-3)
+    static RodCell Cell(int mod, int rod) {
+        if (mod == 0) {
+            return (unsigned) rod < (unsigned) kEMRods ? em[rod] : ComputeCell(G, 0, rod);
+        }
+        return (unsigned) rod < (unsigned) kHADRods ? had[mod - 1][rod] : ComputeCell(G, mod, rod);
+    }
+
+    // Tile of an RPD rod
+    static RodCell RpdCell(int rod) {
+        return (unsigned) rod < (unsigned) kRPDRods ? rpd[rod] : ComputeRpdCell(G, rod);
+    }
+};
+
+typedef Geometry<kRun4> Run4Geometry;
+typedef Geometry<kTestBeam2021> TestBeam2021Geometry;
+typedef Geometry<kLegacy> LegacyGeometry;
+
+} // namespace ZDC
+
+#endif
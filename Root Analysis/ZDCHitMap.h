@@ -0,0 +1,189 @@
+// Compact hit-map layout of the Run4Tree and a reader for it.
+//
+// Instead of six vector<int> branches holding the row or column of every hit, each module (EM, HAD1, HAD2, HAD3)
+// stores its distinct hit rods once, in increasing order, as 16 bit differences to the previous rod, together with
+// the number of hits on each rod:
+//     <mod>_nRods/I, <mod>_RodDelta[<mod>_nRods]/s, <mod>_RodCount[<mod>_nRods]/I
+// Run4HitMapReader rebuilds the old EM_Row ... Total_Column views from it on demand. The rebuilt views hold the
+// same hits as before, ordered by module and rod instead of by Geant4 hit order.
+
+#ifndef ZDC_HIT_MAP_H
+#define ZDC_HIT_MAP_H
+
+#include <algorithm>
+#include <vector>
+#include "TBranch.h"
+#include "TError.h"
+#include "TTree.h"
+#include "ZDCGeometry.h"
+
+namespace ZDC {
+
+// Branch name prefixes of the EM + HAD1,2,3 modules
+inline const char *const kHitMapModules[4] = {"EM", "HAD1", "HAD2", "HAD3"};
+
+// Distinct rods an event can hold per module, every rod ID that fits in 16 bits
+const int kMaxPackedRods = 1 << 16;
+
+// Hits of one module in the compact layout
+struct PackedRods {
+    Int_t nRods = 0;
+    std::vector<UShort_t> delta;
+    std::vector<Int_t> count;
+
+    PackedRods() : delta(kMaxPackedRods), count(kMaxPackedRods) {}
+};
+
+// Packs the rods of one module's hits, using scratch as sorting space.
+// Returns the number of hits dropped because their rod ID does not fit in 16 bits.
+inline int PackRods(const std::vector<int> &rods, std::vector<int> &scratch, PackedRods &packed) {
+    scratch.assign(rods.begin(), rods.end());
+    std::sort(scratch.begin(), scratch.end());
+
+    int dropped = 0, previous = 0;
+    packed.nRods = 0;
+    for (size_t i = 0; i < scratch.size(); i++) {
+        int rod = scratch[i];
+        if (rod < 0 || rod >= kMaxPackedRods) {
+            dropped++;
+            continue;
+        }
+        if (packed.nRods > 0 && rod == previous) {
+            packed.count[packed.nRods - 1]++;
+        } else {
+            packed.delta[packed.nRods] = rod - previous;
+            packed.count[packed.nRods] = 1;
+            packed.nRods++;
+            previous = rod;
+        }
+    }
+    return dropped;
+}
+
+// Creates the three compact branches of one module
+inline void BranchPackedRods(TTree *tree, const char *prefix, PackedRods &packed) {
+    tree->Branch(Form("%s_nRods", prefix), &packed.nRods, Form("%s_nRods/I", prefix));
+    tree->Branch(Form("%s_RodDelta", prefix), packed.delta.data(), Form("%s_RodDelta[%s_nRods]/s", prefix, prefix));
+    tree->Branch(Form("%s_RodCount", prefix), packed.count.data(), Form("%s_RodCount[%s_nRods]/I", prefix, prefix));
+}
+
+// Reads the compact hit maps of a Run4Tree. GetEntry only reads the compact branches; the row and column views are
+// decoded the first time they are asked for in each entry.
+class Run4HitMapReader {
+public:
+    explicit Run4HitMapReader(TTree *tree) : fTree(tree) {
+        for (int mod = 0; mod < 4; mod++) {
+            if (!tree->GetBranch(Form("%s_RodDelta", kHitMapModules[mod]))) {
+                Error("Run4HitMapReader", "%s has no compact hit-map branches", tree->GetName());
+                fTree = nullptr;
+                return;
+            }
+        }
+    }
+
+    bool IsValid() const { return fTree != nullptr; }
+    Long64_t GetEntries() const { return fTree ? fTree->GetEntries() : 0; }
+
+    // Reads the hit maps of an entry, returns the number of bytes read
+    Int_t GetEntry(Long64_t entry) {
+        fDecoded = 0;
+        Long64_t local = fTree->LoadTree(entry);
+        if (local < 0) return 0;
+        // A TChain moves on to the tree of another file: attach to its branches
+        if (fTree->GetTreeNumber() != fTreeNumber) {
+            Bind(fTree->GetTree());
+            fTreeNumber = fTree->GetTreeNumber();
+        }
+
+        Int_t nBytes = 0;
+        for (int mod = 0; mod < 4; mod++) {
+            for (int b = 0; b < 3; b++) {
+                nBytes += fBranches[mod][b]->GetEntry(local);
+            }
+        }
+        return nBytes;
+    }
+
+    // Compact hit map of module mod (0 = EM, 1-3 = HAD1-3)
+    const PackedRods &Packed(int mod) const { return fPacked[mod]; }
+
+    // Rod ID of every hit in module mod, one element per hit
+    const std::vector<int> &Rods(int mod) {
+        if (!Decoded(kRods0 << mod)) {
+            std::vector<int> &rods = fRods[mod];
+            rods.clear();
+            int rod = 0;
+            for (int i = 0; i < fPacked[mod].nRods; i++) {
+                rod += fPacked[mod].delta[i];
+                rods.insert(rods.end(), fPacked[mod].count[i], rod);
+            }
+        }
+        return fRods[mod];
+    }
+
+    // Views matching the EM_Row ... Total_Column vector branches of the original layout
+    const std::vector<int> &EM_Row() { return View(kEMRow); }
+    const std::vector<int> &EM_Column() { return View(kEMColumn); }
+    const std::vector<int> &HAD_Row() { return View(kHADRow); }
+    const std::vector<int> &HAD_Column() { return View(kHADColumn); }
+    const std::vector<int> &Total_Row() { return View(kTotalRow); }
+    const std::vector<int> &Total_Column() { return View(kTotalColumn); }
+
+private:
+    void Bind(TTree *tree) {
+        for (int mod = 0; mod < 4; mod++) {
+            const char *prefix = kHitMapModules[mod];
+            fBranches[mod][0] = tree->GetBranch(Form("%s_nRods", prefix));
+            fBranches[mod][1] = tree->GetBranch(Form("%s_RodDelta", prefix));
+            fBranches[mod][2] = tree->GetBranch(Form("%s_RodCount", prefix));
+            fBranches[mod][0]->SetAddress(&fPacked[mod].nRods);
+            fBranches[mod][1]->SetAddress(fPacked[mod].delta.data());
+            fBranches[mod][2]->SetAddress(fPacked[mod].count.data());
+        }
+    }
+
+    enum ViewId { kEMRow, kEMColumn, kHADRow, kHADColumn, kTotalRow, kTotalColumn, kNViews };
+    static const unsigned kRods0 = 1u << kNViews;
+
+    // Marks the view as decoded, returns whether it already was
+    bool Decoded(unsigned bit) {
+        bool decoded = fDecoded & bit;
+        fDecoded |= bit;
+        return decoded;
+    }
+
+    const std::vector<int> &View(ViewId id) {
+        std::vector<int> &view = fViews[id];
+        if (Decoded(1u << id)) return view;
+
+        view.clear();
+        bool em = id == kEMRow || id == kEMColumn;
+        bool had = id == kHADRow || id == kHADColumn;
+        bool row = id == kEMRow || id == kHADRow || id == kTotalRow;
+        bool total = id == kTotalRow || id == kTotalColumn;
+        for (int mod = 0; mod < 4; mod++) {
+            if ((mod == 0 && had) || (mod > 0 && em)) continue;
+            for (int rod : Rods(mod)) {
+                const RodCell cell = Run4Geometry::Cell(mod, rod);
+                if (total) {
+                    view.push_back(row ? cell.totalRow : cell.totalColumn);
+                } else {
+                    view.push_back(row ? cell.row : cell.column);
+                }
+            }
+        }
+        return view;
+    }
+
+    TTree *fTree;
+    Int_t fTreeNumber = -1;
+    TBranch *fBranches[4][3] = {};
+    PackedRods fPacked[4];
+    std::vector<int> fRods[4];
+    std::vector<int> fViews[kNViews];
+    unsigned fDecoded = 0;
+};
+
+} // namespace ZDC
+
+#endif
@@ -0,0 +1,251 @@
+// Event-loop instrumentation of the converters: stage timers, progress reporting and an end-of-run summary.
+//
+// Every event loop (one per chunk) asks Monitor() for its own StageCounters and times its stages with ScopedStage:
+//     read      ZDC::EventSource::GetEntry / TTree::GetEntry
+//     segment   decoding the hits into rows, columns and segments
+//     fill      TTree::Fill or histogram filling
+//     write     writing and closing the output
+//     merge     fast-merging the chunk outputs into the output, once per threaded run
+// A counters block is only ever written by the thread running its loop, so timing a stage costs two clock reads
+// and a few additions, without locks or shared cache lines. Progress (events/s, ETA) is printed at most once per
+// progress interval instead of once per event. End() aggregates the blocks per stage and per thread and writes the
+// summary as JSON, by default next to the output as <output>.perf.json.
+
+#ifndef ZDC_INSTRUMENTATION_H
+#define ZDC_INSTRUMENTATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TError.h"
+#include "TString.h"
+
+namespace ZDC {
+
+enum Stage { kStageRead = 0, kStageSegment, kStageFill, kStageWrite, kStageMerge, kNStages };
+inline const char *const kStageNames[kNStages] = {"read", "segment", "fill", "write", "merge"};
+
+// Duration histogram: bucket b counts durations in [2^b, 2^(b+1)) ns, the last one everything longer
+const int kDurationBuckets = 40;
+
+struct StageStats {
+    uint64_t count = 0;
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+    uint64_t buckets[kDurationBuckets] = {};
+
+    void Add(uint64_t ns) {
+        count++;
+        totalNs += ns;
+        if (ns > maxNs) maxNs = ns;
+        int bucket = ns > 0 ? 63 - __builtin_clzll(ns) : 0;
+        buckets[bucket < kDurationBuckets ? bucket : kDurationBuckets - 1]++;
+    }
+
+    void Merge(const StageStats &other) {
+        count += other.count;
+        totalNs += other.totalNs;
+        if (other.maxNs > maxNs) maxNs = other.maxNs;
+        for (int b = 0; b < kDurationBuckets; b++) buckets[b] += other.buckets[b];
+    }
+};
+
+// Counters of one event loop, written only by the thread running it
+struct alignas(64) StageCounters {
+    std::thread::id thread = std::this_thread::get_id();
+    StageStats stages[kNStages];
+    std::atomic<uint64_t> events{0};    // Read by the progress report while the loop runs
+    unsigned sinceCheck = 0;
+};
+
+typedef std::chrono::steady_clock MonitorClock;
+
+inline uint64_t ElapsedNs(MonitorClock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(MonitorClock::now() - start).count();
+}
+
+// s as a quoted JSON string, with quotes, backslashes and control characters escaped
+inline std::string JSONString(const std::string &s) {
+    std::string quoted = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c < 0x20) {
+            quoted += Form("\\u%04x", c);
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+// Adds the lifetime of the object to a stage
+class ScopedStage {
+public:
+    ScopedStage(StageCounters &counters, Stage stage)
+            : fStats(counters.stages[stage]), fStart(MonitorClock::now()) {}
+    ~ScopedStage() { fStats.Add(ElapsedNs(fStart)); }
+
+private:
+    StageStats &fStats;
+    MonitorClock::time_point fStart;
+};
+
+class RunMonitor {
+public:
+    // Events between two looks at the clock in EventDone
+    static const unsigned kCheckEvery = 64;
+
+    // Seconds between two progress lines, 0 or less turns progress reporting off
+    void SetProgressInterval(double seconds) { fIntervalNs = seconds > 0 ? (int64_t) (seconds * 1e9) : -1; }
+
+    // Starts a run of expectedEvents events, dropping the counters of the previous one
+    void Begin(const std::string &name, Long64_t expectedEvents) {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fName = name;
+        fExpected = expectedEvents;
+        fCounters.clear();
+        fStart = MonitorClock::now();
+        fLastReportNs = 0;
+    }
+
+    // A new counters block for an event loop of the calling thread
+    StageCounters &NewCounters() {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fCounters.emplace_back(new StageCounters);
+        return *fCounters.back();
+    }
+
+    // Counts an event, and prints the progress if the interval is over
+    void EventDone(StageCounters &counters) {
+        counters.events.store(counters.events.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (++counters.sinceCheck < kCheckEvery) return;
+        counters.sinceCheck = 0;
+        if (fIntervalNs < 0) return;
+
+        int64_t now = ElapsedNs(fStart);
+        int64_t last = fLastReportNs.load(std::memory_order_relaxed);
+        if (now - last < fIntervalNs) return;
+        // Only the thread that moves the report time forward prints
+        if (fLastReportNs.compare_exchange_strong(last, now)) PrintProgress(now);
+    }
+
+    // Events counted so far in this run
+    Long64_t Events() {
+        std::lock_guard<std::mutex> lock(fMutex);
+        Long64_t events = 0;
+        for (const auto &counters : fCounters) events += counters->events.load(std::memory_order_relaxed);
+        return events;
+    }
+
+    // Ends the run: prints the time spent in each stage and writes the JSON summary to summaryPath (if not empty).
+    // Call after all event loops have finished.
+    void End(const std::string &summaryPath) {
+        double wall = ElapsedNs(fStart) / 1e9;
+        std::lock_guard<std::mutex> lock(fMutex);
+
+        StageStats total[kNStages];
+        std::map<std::thread::id, size_t> threadIndex;
+        std::vector<std::vector<double>> threadSeconds;    // Per thread: events, then seconds of each stage
+        Long64_t events = 0;
+        for (const auto &counters : fCounters) {
+            auto it = threadIndex.find(counters->thread);
+            if (it == threadIndex.end()) {
+                it = threadIndex.emplace(counters->thread, threadSeconds.size()).first;
+                threadSeconds.emplace_back(kNStages + 1, 0.);
+            }
+            uint64_t loopEvents = counters->events.load();
+            events += loopEvents;
+            threadSeconds[it->second][0] += loopEvents;
+            for (int s = 0; s < kNStages; s++) {
+                total[s].Merge(counters->stages[s]);
+                threadSeconds[it->second][s + 1] += counters->stages[s].totalNs / 1e9;
+            }
+        }
+
+        printf("%s: %lld events in %.2f s, %.0f events/s\n", fName.c_str(), events, wall, wall > 0 ? events / wall : 0.);
+        for (int s = 0; s < kNStages; s++) {
+            if (total[s].count == 0) continue;
+            printf("  %-8s %10.3f s  %10.2f us/call  max %10.2f us  (%llu calls)\n", kStageNames[s],
+                   total[s].totalNs / 1e9, total[s].totalNs / 1e3 / total[s].count, total[s].maxNs / 1e3,
+                   (unsigned long long) total[s].count);
+        }
+        if (summaryPath.empty()) return;
+
+        std::ofstream out(summaryPath);
+        out << "{\n";
+        out << "  \"run\": " << JSONString(fName) << ",\n";
+        out << Form("  \"events\": %lld,\n  \"expected_events\": %lld,\n", events, fExpected);
+        out << Form("  \"wall_s\": %.6f,\n  \"events_per_s\": %.2f,\n", wall, wall > 0 ? events / wall : 0.);
+        out << "  \"stages\": {\n";
+        for (int s = 0; s < kNStages; s++) {
+            const StageStats &st = total[s];
+            out << Form("    \"%s\": {\"count\": %llu, \"total_s\": %.6f, \"mean_us\": %.3f, \"max_us\": %.3f, "
+                        "\"histogram_ns\": [", kStageNames[s], (unsigned long long) st.count, st.totalNs / 1e9,
+                        st.count ? st.totalNs / 1e3 / st.count : 0., st.maxNs / 1e3);
+            bool first = true;
+            for (int b = 0; b < kDurationBuckets; b++) {
+                if (st.buckets[b] == 0) continue;
+                out << Form("%s[%llu, %llu]", first ? "" : ", ", 1ull << b, (unsigned long long) st.buckets[b]);
+                first = false;
+            }
+            out << (s + 1 < kNStages ? "]},\n" : "]}\n");
+        }
+        out << "  },\n  \"threads\": [\n";
+        for (size_t t = 0; t < threadSeconds.size(); t++) {
+            out << Form("    {\"thread\": %zu, \"events\": %.0f", t, threadSeconds[t][0]);
+            for (int s = 0; s < kNStages; s++) {
+                out << Form(", \"%s_s\": %.6f", kStageNames[s], threadSeconds[t][s + 1]);
+            }
+            out << (t + 1 < threadSeconds.size() ? "},\n" : "}\n");
+        }
+        out << "  ]\n}\n";
+        if (!out) Error("ZDC::RunMonitor", "Failed to write the run summary %s", summaryPath.c_str());
+    }
+
+private:
+    void PrintProgress(int64_t nowNs) {
+        Long64_t done = Events();
+        double seconds = nowNs / 1e9;
+        double rate = seconds > 0 ? done / seconds : 0;
+        if (fExpected > 0 && rate > 0) {
+            printf("%s: %lld of %lld events (%.1f%%), %.0f events/s, ETA %.0f s\n", fName.c_str(), done, fExpected,
+                   100. * done / fExpected, rate, (fExpected - done) / rate);
+        } else {
+            printf("%s: %lld events, %.0f events/s\n", fName.c_str(), done, rate);
+        }
+        fflush(stdout);
+    }
+
+    std::mutex fMutex;
+    std::string fName;
+    Long64_t fExpected = 0;
+    std::vector<std::unique_ptr<StageCounters>> fCounters;
+    MonitorClock::time_point fStart = MonitorClock::now();
+    std::atomic<int64_t> fLastReportNs{0};
+    int64_t fIntervalNs = 1000000000;
+};
+
+// Monitor of the running conversion
+inline RunMonitor &Monitor() {
+    static RunMonitor monitor;
+    return monitor;
+}
+
+// Summary file written next to an output file
+inline std::string SummaryName(const std::string &outName) {
+    return outName + ".perf.json";
+}
+
+} // namespace ZDC
+
+#endif
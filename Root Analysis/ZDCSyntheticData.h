@@ -0,0 +1,157 @@
+// Synthetic input shards with the layout of the Geant4 output the converters read.
+//
+// Every shard <base>_<i>.root holds the six input trees with one entry per event:
+//     EventData   energy (primary energy, MeV), lastStepZ (vector<double>, z of the last step of the primary, mm)
+//     RPD1tree    rodNo, nCherenkovs (vector<int>, one element per fiber hit)
+//     ZDC1tree    rodNo, nCherenkovs (vector<int>, one element per rod hit), EM module
+//     ZDC2-4tree  the same for HAD1-3
+// Hit multiplicities are Poisson around a per-event shower size that fluctuates by a Gaussian factor, each HAD module
+// seeing half the hits of the one in front of it. Rods follow an exponential longitudinal profile from the front of
+// each module and a Gaussian transverse profile around its central column, inside the rod ranges of the Run 4 or
+// TB21 geometry. The physics is only shaped to give the converters realistic work; it is not a simulation.
+// Each shard has its own random seed, so the output does not depend on the number of threads writing it.
+
+#ifndef ZDC_SYNTHETIC_DATA_H
+#define ZDC_SYNTHETIC_DATA_H
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "TError.h"
+#include "TFile.h"
+#include "TRandom3.h"
+#include "TTree.h"
+#include "ZDCConversionEngine.h"
+#include "ZDCGeometry.h"
+
+namespace ZDC {
+
+struct SyntheticSettings {
+    std::string base = "synthetic";     // Shards are <base>_0.root ... <base>_{nFiles-1}.root
+    std::string geometry = "run4";      // run4 or tb21, sets the rod ranges
+    Long64_t events = 10000;            // Events per shard
+    int nFiles = 1;
+    double emHits = 400;                // Mean rod hits per event in the EM module
+    double hadHits = 150;               // Mean rod hits per event in HAD1, halved in each following module
+    double rpdHits = 60;                // Mean fiber hits per event in the RPD
+    double fluctuation = 0.3;           // Relative spread of the shower size from event to event
+    double showerDepth = 6;             // Mean depth of a hit in rows from the front of its module
+    double showerWidth = 4;             // Transverse spread of the hits in columns (RPD: in tiles / 4)
+    double photonsPerHit = 3;           // Mean nCherenkovs of a hit, at least 1
+    double energy = 380e3;              // Primary energy in MeV
+    int compression = 101;              // ROOT compression setting, 100 * algorithm + level (101 = zlib 1)
+    unsigned seed = 4357;
+    int nThreads = 1;                   // Shards written in parallel, 0 = one thread per core
+};
+
+inline const GeometryDescriptor *SyntheticGeometry(const std::string &name) {
+    if (name == "run4") return &kRun4;
+    if (name == "tb21") return &kTestBeam2021;
+    return nullptr;
+}
+
+// Appends n hits of a module with rows x rodsPerRow rods to rods and nCherenkovs
+inline void GenerateModuleHits(TRandom &rng, const SyntheticSettings &s, int rows, int rodsPerRow, int n,
+                               std::vector<int> &rods, std::vector<int> &nCherenkovs) {
+    for (int i = 0; i < n; i++) {
+        int row = (int) rng.Exp(s.showerDepth);
+        int column = (int) std::lround(rng.Gaus((rodsPerRow - 1) / 2., s.showerWidth));
+        if (row >= rows) row = rows - 1;
+        if (column < 0) column = 0;
+        if (column >= rodsPerRow) column = rodsPerRow - 1;
+        rods.push_back(row * rodsPerRow + column);
+        nCherenkovs.push_back(1 + rng.Poisson(std::max(0., s.photonsPerHit - 1)));
+    }
+}
+
+// Appends n fiber hits, spread over the RPD tiles like the shower core and uniformly within a tile
+inline void GenerateRpdHits(TRandom &rng, const SyntheticSettings &s, const GeometryDescriptor &g, int n,
+                            std::vector<int> &rods, std::vector<int> &nCherenkovs) {
+    int rodsPerRow = g.rpdRods / g.rpdRows;
+    int rodsPerTile = rodsPerRow / g.rpdTilesPerRow;
+    for (int i = 0; i < n; i++) {
+        int row = (int) std::lround(rng.Gaus((g.rpdRows - 1) / 2., s.showerWidth / 4));
+        int tile = (int) std::lround(rng.Gaus((g.rpdTilesPerRow - 1) / 2., s.showerWidth / 4));
+        row = row < 0 ? 0 : (row >= g.rpdRows ? g.rpdRows - 1 : row);
+        tile = tile < 0 ? 0 : (tile >= g.rpdTilesPerRow ? g.rpdTilesPerRow - 1 : tile);
+        rods.push_back(row * rodsPerRow + tile * rodsPerTile + (int) rng.Integer(rodsPerTile));
+        nCherenkovs.push_back(1 + rng.Poisson(std::max(0., s.photonsPerHit - 1)));
+    }
+}
+
+// Writes shard i of the settings, returns false if the file cannot be created
+inline bool GenerateShard(const SyntheticSettings &s, const GeometryDescriptor &g, int shard,
+                          const std::string &name) {
+    TFile *f = new TFile(name.c_str(), "RECREATE", "Synthetic ZDC/RPD shard", s.compression);
+    if (f->IsZombie()) {
+        Error("ZDC::GenerateShard", "Cannot create %s", name.c_str());
+        delete f;
+        return false;
+    }
+
+    double energy = s.energy;
+    std::vector<double> lastStepZ;
+    std::vector<int> rods[5], nCherenkovs[5];    // RPD, EM, HAD1, HAD2, HAD3
+    TTree *trees[6];
+    for (int t = 0; t < 6; t++) {
+        trees[t] = new TTree(kInputTrees[t], kInputTrees[t]);
+    }
+    trees[0]->Branch("energy", &energy, "energy/D");
+    trees[0]->Branch("lastStepZ", &lastStepZ);
+    for (int t = 1; t < 6; t++) {
+        trees[t]->Branch("rodNo", &rods[t - 1]);
+        trees[t]->Branch("nCherenkovs", &nCherenkovs[t - 1]);
+    }
+
+    // TRandom3 draws a random seed for 0, keep the seeds of all shards non-zero
+    TRandom3 rng(s.seed + shard + 1);
+    for (Long64_t q = 0; q < s.events; q++) {
+        double size = std::max(0., rng.Gaus(1, s.fluctuation));
+        lastStepZ.assign(1, rng.Exp(400.));
+        for (int m = 0; m < 5; m++) {
+            rods[m].clear();
+            nCherenkovs[m].clear();
+        }
+        GenerateRpdHits(rng, s, g, rng.Poisson(size * s.rpdHits), rods[0], nCherenkovs[0]);
+        GenerateModuleHits(rng, s, g.emRows, g.emRodsPerRow, rng.Poisson(size * s.emHits), rods[1], nCherenkovs[1]);
+        for (int m = 0; m < 3; m++) {
+            int n = rng.Poisson(size * s.hadHits / (1 << m));
+            GenerateModuleHits(rng, s, g.hadRowsPerModule, g.hadRodsPerRow, n, rods[m + 2], nCherenkovs[m + 2]);
+        }
+        for (int t = 0; t < 6; t++) {
+            trees[t]->Fill();
+        }
+    }
+
+    f->Write();
+    f->Close();
+    delete f;
+    return true;
+}
+
+// Writes all shards of the settings, returns their names or nothing on failure
+inline std::vector<std::string> GenerateShards(const SyntheticSettings &s) {
+    const GeometryDescriptor *g = SyntheticGeometry(s.geometry);
+    if (!g) {
+        Error("ZDC::GenerateShards", "Unknown geometry %s, expected run4 or tb21", s.geometry.c_str());
+        return {};
+    }
+    std::vector<std::string> files = ShardFiles(s.base, s.nFiles);
+    std::vector<Chunk> shards;
+    for (int i = 0; i < s.nFiles; i++) {
+        shards.push_back({i, 0, s.events});
+    }
+    std::vector<char> written(s.nFiles, 0);
+    RunChunks(shards, s.nThreads, [&](const Chunk &shard) {
+        written[shard.index] = GenerateShard(s, *g, shard.index, files[shard.index]);
+    });
+    for (char ok : written) {
+        if (!ok) return {};
+    }
+    return files;
+}
+
+} // namespace ZDC
+
+#endif